@@ -4,7 +4,7 @@
 
  Copyright 2015 Nick Gammon.
 
- Version: 1.3
+ Version: 1.8
 
    Change history
    --------------
@@ -12,6 +12,11 @@
          Also various bugfixes.
    1.2 - Added buffering of writes.
    1.3 - Removed trailing space from header and cookie values
+   1.4 - Added deferred responses (defer / poll / processDeferredResponse)
+   1.5 - Added processIncomingBytes, body sink and bodyReceived for fast uploads
+   1.6 - Added Range / If-Range support (206 Partial Content, multipart/byteranges)
+   1.7 - Added WebSocket upgrade, frame decoding and sending
+   1.8 - Added Server-Sent Events (text/event-stream) responses
 
 
    http://www.gammon.com.au/forum/?id=12942
@@ -41,6 +46,128 @@
 
 #include <Arduino.h>
 #include <HTTPserver.h>
+#include <errno.h>
+
+// separates the parts of a multipart/byteranges response
+#define RANGE_BOUNDARY "HTTPserver_byteranges"
+
+// discards output, but counts it (to work out a Content-Length in advance)
+class NullPrint : public Print
+  {
+  public:
+    size_t write (uint8_t c) { return 1; }
+    using Print::write;
+  };  // end of NullPrint
+
+// appended to Sec-WebSocket-Key to make Sec-WebSocket-Accept (RFC 6455)
+static const char WEBSOCKET_GUID [] PROGMEM = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// WebSocket opcodes
+enum {
+  WS_CONTINUATION = 0x0,
+  WS_TEXT         = 0x1,
+  WS_BINARY       = 0x2,
+  WS_CLOSE        = 0x8,
+  WS_PING         = 0x9,
+  WS_PONG         = 0xA,
+};
+
+// ---------------------------------------------------------------------------
+// SHA-1 - just enough for the WebSocket handshake
+// ---------------------------------------------------------------------------
+struct Sha1Type
+  {
+  uint32_t hash [5];
+  byte block [64];
+  byte blockPos;
+  unsigned long length;  // in bytes
+  };
+
+static uint32_t sha1Rotate (const uint32_t value, const byte bits)
+  {
+  return (value << bits) | (value >> (32 - bits));
+  } // end of sha1Rotate
+
+static void sha1Block (Sha1Type & sha)
+  {
+  uint32_t w [16];
+  for (byte i = 0; i < 16; i++)
+    w [i] = ((uint32_t) sha.block [i * 4] << 24) | ((uint32_t) sha.block [i * 4 + 1] << 16) |
+            ((uint32_t) sha.block [i * 4 + 2] << 8) | sha.block [i * 4 + 3];
+
+  uint32_t a = sha.hash [0], b = sha.hash [1], c = sha.hash [2], d = sha.hash [3], e = sha.hash [4];
+  for (byte i = 0; i < 80; i++)
+    {
+    // message schedule kept as a rolling window of 16 words
+    if (i >= 16)
+      w [i & 15] = sha1Rotate (w [(i + 13) & 15] ^ w [(i + 8) & 15] ^ w [(i + 2) & 15] ^ w [i & 15], 1);
+
+    uint32_t f, k;
+    if (i < 20)
+      { f = (b & c) | (~b & d);           k = 0x5A827999; }
+    else if (i < 40)
+      { f = b ^ c ^ d;                    k = 0x6ED9EBA1; }
+    else if (i < 60)
+      { f = (b & c) | (b & d) | (c & d);  k = 0x8F1BBCDC; }
+    else
+      { f = b ^ c ^ d;                    k = 0xCA62C1D6; }
+
+    uint32_t temp = sha1Rotate (a, 5) + f + e + k + w [i & 15];
+    e = d;
+    d = c;
+    c = sha1Rotate (b, 30);
+    b = a;
+    a = temp;
+    } // end of for each round
+
+  sha.hash [0] += a;
+  sha.hash [1] += b;
+  sha.hash [2] += c;
+  sha.hash [3] += d;
+  sha.hash [4] += e;
+  sha.blockPos = 0;
+  } // end of sha1Block
+
+static void sha1Init (Sha1Type & sha)
+  {
+  sha.hash [0] = 0x67452301;
+  sha.hash [1] = 0xEFCDAB89;
+  sha.hash [2] = 0x98BADCFE;
+  sha.hash [3] = 0x10325476;
+  sha.hash [4] = 0xC3D2E1F0;
+  sha.blockPos = 0;
+  sha.length = 0;
+  } // end of sha1Init
+
+static void sha1Add (Sha1Type & sha, const byte inByte)
+  {
+  sha.block [sha.blockPos++] = inByte;
+  sha.length++;
+  if (sha.blockPos >= sizeof sha.block)
+    sha1Block (sha);
+  } // end of sha1Add
+
+static void sha1Final (Sha1Type & sha, byte * digest)
+  {
+  unsigned long bits = sha.length * 8;
+
+  // pad with 0x80 then zeroes, leaving room for the 64-bit length
+  sha.block [sha.blockPos++] = 0x80;
+  if (sha.blockPos > 56)
+    {
+    while (sha.blockPos < 64)
+      sha.block [sha.blockPos++] = 0;
+    sha1Block (sha);
+    }
+  while (sha.blockPos < 56)
+    sha.block [sha.blockPos++] = 0;
+  for (byte i = 0; i < 8; i++)
+    sha.block [56 + i] = i < 4 ? 0 : bits >> ((7 - i) * 8);
+  sha1Block (sha);
+
+  for (byte i = 0; i < 20; i++)
+    digest [i] = sha.hash [i / 4] >> ((3 - (i & 3)) * 8);
+  } // end of sha1Final
 
 // ---------------------------------------------------------------------------
 // clear the key/value buffers ready for a new key/value
@@ -154,12 +281,46 @@ void HTTPserver::addToBodyBuffer (const byte inByte)
   if (bodyBufferPos >= BODY_CHUNK_LENGTH)
     {
       // pass current chunk to the application and empty it
-      processBodyChunk (bodyBuffer, bodyBufferPos, flags);
-      bodyBufferPos = 0;
+      flushBodyBuffer ();
     }  // end of overflow
     bodyBuffer [bodyBufferPos++] = inByte;
   } // end of HTTPserver::addToBodyBuffer
 
+// ---------------------------------------------------------------------------
+// pass any partial body chunk to the application and empty the buffer
+// ---------------------------------------------------------------------------
+void HTTPserver::flushBodyBuffer ()
+  {
+  // empty it first, in case the application calls getBodyRemaining from processBodyChunk
+  const size_t count = bodyBufferPos;
+  bodyBufferPos = 0;
+  if (count > 0)
+    deliverBody (bodyBuffer, count);
+  } // end of HTTPserver::flushBodyBuffer
+
+// ---------------------------------------------------------------------------
+// hand binary body data to the body sink, or to the application
+// ---------------------------------------------------------------------------
+void HTTPserver::deliverBody (const byte * data, const size_t length)
+  {
+  if (!bodySink)
+    {
+    processBodyChunk (data, length, flags);
+    return;
+    }
+
+  // already failed? don't write the rest with a hole in it
+  if (bodySinkFailed)
+    return;
+
+  // short write (eg. disk full) - stop, so the application can report an error
+  if (bodySink->write (data, length) != length)
+    {
+    bodySinkFailed = true;
+    done = true;
+    }
+  } // end of HTTPserver::deliverBody
+
 // ---------------------------------------------------------------------------
 //  handleSpace - we have an incoming space
 // ---------------------------------------------------------------------------
@@ -263,6 +424,15 @@ void HTTPserver::handleNewline ()
     // a blank line on its own signals switching to the POST key/values or binary body
     case START_LINE:
       clearBuffers ();
+      // or to WebSocket frames, if asked for and the application agrees
+      if (webSocketHandshake == WS_GOT_ALL && acceptWebSocket ())
+        {
+        sendWebSocketHandshake ();
+        webSocket = true;
+        webSocketFragmented = false;
+        newState (WEBSOCKET_OPCODE);
+        break;
+        }
       newState (binaryBody ? BODY : POST_NAME);
       break;
 
@@ -283,6 +453,14 @@ void HTTPserver::handleNewline ()
         contentLength = atol (valueBuffer);
       if (strcasecmp (keyBuffer, "Content-Type") == 0 && strcasecmp (valueBuffer, "application/octet-stream") == 0)
         binaryBody = true;
+      // remember byte ranges (a truncated list is no use)
+      if (strcasecmp (keyBuffer, "Range") == 0 && !(flags & FLAG_VALUE_BUFFER_OVERFLOW))
+        parseRange (valueBuffer);
+      if (strcasecmp (keyBuffer, "If-Range") == 0)
+        ifRangeFailed = !processIfRange (valueBuffer, flags);
+      handleWebSocketHeader (keyBuffer, valueBuffer);
+      if (strcasecmp (keyBuffer, "Last-Event-ID") == 0)
+        processLastEventId (valueBuffer, flags);
       clearBuffers ();
       newState (START_LINE);
       break;
@@ -457,6 +635,10 @@ void HTTPserver::handleText (const byte inByte)
     // we think line is done, skip whatever we find
     case SKIP_TO_END_OF_LINE:
       break;  // ignore it
+
+    default:
+      break;  // do nothing
+
     } // end of switch on state
 
   }  // end of HTTPserver::handleText
@@ -467,6 +649,13 @@ void HTTPserver::handleText (const byte inByte)
 void HTTPserver::processIncomingByte (const byte inByte)
   {
 
+  // once upgraded, everything is WebSocket frames
+  if (webSocket)
+    {
+    handleWebSocket (inByte);
+    return;
+    }
+
   // count received bytes in POST section or binary body
   if (state == POST_NAME || state == POST_VALUE || state == BODY)
     receivedLength++;
@@ -479,7 +668,7 @@ void HTTPserver::processIncomingByte (const byte inByte)
     if (receivedLength >= contentLength)
       {
       // wrap up last partial binary chunk (always at least 1 byte here by definition)
-      processBodyChunk (bodyBuffer, bodyBufferPos, flags);
+      flushBodyBuffer ();
       clearBuffers ();
       done = true;
       }
@@ -525,8 +714,90 @@ void HTTPserver::processIncomingByte (const byte inByte)
       done = true;
     } // end of up to the POST states
 
+  // binary body with no content? nothing more to come
+  if (state == BODY && receivedLength >= contentLength)
+    done = true;
+
   } // end of HTTPserver::processIncomingByte
 
+// ---------------------------------------------------------------------------
+//  processIncomingBytes - our main sketch has received a buffer from the client
+// ---------------------------------------------------------------------------
+size_t HTTPserver::processIncomingBytes (const byte * data, const size_t length)
+  {
+  size_t pos = 0;
+  while (pos < length && !done)
+    {
+    // inside a binary body pass the caller's buffer through in one go
+    if (state == BODY)
+      {
+      size_t count = length - pos;
+      if (count > contentLength - receivedLength)
+        count = contentLength - receivedLength;
+      flushBodyBuffer ();
+      receivedLength += count;
+      deliverBody (&data [pos], count);
+      pos += count;
+
+      // if all received, stop now
+      if (receivedLength >= contentLength)
+        {
+        clearBuffers ();
+        done = true;
+        }
+      }
+    // inside a WebSocket payload unmask as much as we can in one go
+    else if (state == WEBSOCKET_PAYLOAD)
+      {
+      size_t count = length - pos;
+      if (count > contentLength - receivedLength)
+        count = contentLength - receivedLength;
+      handleWebSocketPayload (&data [pos], count);
+      pos += count;
+      }
+    else
+      processIncomingByte (data [pos++]);
+    } // end of while
+
+  return pos;
+  } // end of HTTPserver::processIncomingBytes
+
+// ---------------------------------------------------------------------------
+//  getBodyRemaining - how much binary body is still to come
+// ---------------------------------------------------------------------------
+unsigned long HTTPserver::getBodyRemaining ()
+  {
+  if (state != BODY)
+    return 0;
+
+  // the application may be about to read the rest itself, so pass on
+  // what we already have first, or it would arrive after their data
+  flushBodyBuffer ();
+  return contentLength - receivedLength;
+  } // end of HTTPserver::getBodyRemaining
+
+// ---------------------------------------------------------------------------
+//  bodyReceived - the application has read count bytes of the body itself
+// ---------------------------------------------------------------------------
+void HTTPserver::bodyReceived (unsigned long count)
+  {
+  if (state != BODY)
+    return;
+
+  // can't have had more than was still to come
+  if (count > contentLength - receivedLength)
+    count = contentLength - receivedLength;
+
+  receivedLength += count;
+
+  // if all received, stop now
+  if (receivedLength >= contentLength)
+    {
+    clearBuffers ();
+    done = true;
+    }
+  } // end of HTTPserver::bodyReceived
+
 // ---------------------------------------------------------------------------
 //  begin - reset state machine to the start
 // ---------------------------------------------------------------------------
@@ -542,10 +813,36 @@ void HTTPserver::begin (Print * output_)
   receivedLength = 0;
   sendBufferPos = 0;
   output = output_;
+  bodySink = NULL;
+  bodySinkFailed = false;
+  rangeCount = 0;
+  ifRangeFailed = false;
+  webSocket = false;
+  webSocketHandshake = 0;
+  eventStream = false;
+  eventData = false;
+  eventNewline = false;
   clearBuffers ();
   done = false;
+  deferred = false;
   } // end of HTTPserver::begin
 
+// ---------------------------------------------------------------------------
+//  poll - continue a deferred response, if any
+// ---------------------------------------------------------------------------
+void HTTPserver::poll ()
+  {
+  if (!deferred)
+    return;
+
+  // ask the application if the response is finished yet
+  if (processDeferredResponse ())
+    {
+    deferred = false;
+    flush ();
+    }
+  } // end of HTTPserver::poll
+
 // ---------------------------------------------------------------------------
 //  write - for outputting via print, println etc.
 // ---------------------------------------------------------------------------
@@ -555,6 +852,23 @@ size_t HTTPserver::write (uint8_t c)
   if (!output)
     return 0;
 
+  // inside event data each line needs its own "data:" field
+  if (eventData)
+    {
+    if (c == '\r')
+      return 1;  // println sends \r\n, the \n will do
+    if (eventNewline)
+      {
+      eventData = false;  // so this goes straight out
+      print (F("\ndata: "));
+      eventData = true;
+      }
+    // hold back a newline in case it is the last thing in the event
+    eventNewline = c == '\n';
+    if (eventNewline)
+      return 1;
+    }
+
   // only buffer writes up, if a non-zero buffer length
   if (SEND_BUFFER_LENGTH > 0)
     {
@@ -650,3 +964,714 @@ void HTTPserver::setCookie (const char * name, const char * value, const char *
 
   } // end of HTTPserver::setCookie
 
+
+// ---------------------------------------------------------------------------
+//  parseRange - remember byte ranges, eg. "bytes=0-499, 1000-, -500"
+// ---------------------------------------------------------------------------
+void HTTPserver::parseRange (const char * value)
+  {
+  rangeCount = 0;
+  if (strncasecmp (value, "bytes=", 6) != 0)
+    return;  // not a unit we know about
+
+  const char * p = value + 6;
+  while (true)
+    {
+    RangeType range;
+    char * end;
+
+    while (*p == ' ')
+      p++;
+
+    range.first = 0;
+    range.last = 0;
+    range.type = 0;
+    errno = 0;  // so we can spot numbers too big to hold
+
+    // -500 (last 500 bytes)
+    if (*p == '-')
+      {
+      if (!isdigit (p [1]))
+        break;  // syntax error
+      range.type = RANGE_SUFFIX;
+      range.last = strtoul (p + 1, &end, 10);
+      }
+    // 0-499 or 1000-
+    else if (isdigit (*p))
+      {
+      range.first = strtoul (p, &end, 10);
+      if (*end != '-')
+        break;  // syntax error
+      p = end + 1;
+      if (isdigit (*p))
+        {
+        range.last = strtoul (p, &end, 10);
+        if (range.last < range.first)
+          break;  // syntax error
+        }
+      else
+        {
+        range.type = RANGE_TO_END;
+        end = (char *) p;
+        }
+      }
+    else
+      break;  // syntax error
+
+    // number overflowed
+    if (errno == ERANGE)
+      break;
+
+    // more than we can keep are ignored
+    if (rangeCount < MAX_RANGES)
+      ranges [rangeCount++] = range;
+
+    p = end;
+    while (*p == ' ')
+      p++;
+    if (*p == 0)
+      return;  // all done and valid
+    if (*p != ',')
+      break;  // syntax error
+    p++;
+    } // end of while
+
+  // an invalid Range header is ignored
+  rangeCount = 0;
+  } // end of HTTPserver::parseRange
+
+// ---------------------------------------------------------------------------
+//  getRange - work out the first and last byte of a wanted range
+// ---------------------------------------------------------------------------
+bool HTTPserver::getRange (const byte which, const unsigned long totalLength, unsigned long & first, unsigned long & last)
+  {
+  if (which >= getRangeCount () || totalLength == 0)
+    return false;
+
+  const RangeType & range = ranges [which];
+
+  // suffix range: the last so-many bytes
+  if (range.type & RANGE_SUFFIX)
+    {
+    if (range.last == 0)
+      return false;
+    first = range.last >= totalLength ? 0 : totalLength - range.last;
+    last = totalLength - 1;
+    return true;
+    }
+
+  // starts past the end?
+  if (range.first >= totalLength)
+    return false;
+
+  first = range.first;
+  last = ((range.type & RANGE_TO_END) || range.last >= totalLength) ? totalLength - 1 : range.last;
+  return true;
+  } // end of HTTPserver::getRange
+
+// ---------------------------------------------------------------------------
+//  countRanges - how many wanted ranges can be satisfied
+// ---------------------------------------------------------------------------
+byte HTTPserver::countRanges (const unsigned long totalLength)
+  {
+  byte count = 0;
+  unsigned long first, last;
+  for (byte i = 0; i < getRangeCount (); i++)
+    if (getRange (i, totalLength, first, last))
+      count++;
+  return count;
+  } // end of HTTPserver::countRanges
+
+// ---------------------------------------------------------------------------
+//  sendRangeData - output bytes first to last from data, or from readResource
+// ---------------------------------------------------------------------------
+void HTTPserver::sendRangeData (const unsigned long first, const unsigned long last, const byte * data)
+  {
+  if (!output)
+    return;
+
+  // from memory - write it in one go
+  if (data)
+    {
+    flush ();
+    output->write (&data [first], last - first + 1);
+    return;
+    }
+
+  // otherwise read straight into the send buffer (if we have one)
+  unsigned long offset = first;
+  while (offset <= last)
+    {
+    size_t got;
+
+    if (sendBufferPos < SEND_BUFFER_LENGTH)
+      {
+      size_t wanted = SEND_BUFFER_LENGTH - sendBufferPos;
+      if (wanted > last - offset + 1)
+        wanted = last - offset + 1;
+      got = readResource (offset, (byte *) &sendBuffer [sendBufferPos], wanted);
+      sendBufferPos += got;
+      if (sendBufferPos >= SEND_BUFFER_LENGTH)
+        flush ();
+      }
+    else
+      {
+      // no send buffer - use a small one of our own
+      byte buffer [BODY_CHUNK_LENGTH];
+      size_t wanted = sizeof buffer;
+      if (wanted > last - offset + 1)
+        wanted = last - offset + 1;
+      got = readResource (offset, buffer, wanted);
+      output->write (buffer, got);
+      }
+
+    // read error: give up (the body will be short of its Content-Length)
+    if (got == 0)
+      break;
+    offset += got;
+    } // end of while
+  } // end of HTTPserver::sendRangeData
+
+// ---------------------------------------------------------------------------
+//  sendByteranges - output a multipart/byteranges body, returns its length
+// ---------------------------------------------------------------------------
+unsigned long HTTPserver::sendByteranges (Print & out, const unsigned long totalLength, const char * contentType,
+                                          const byte * data, const bool withData)
+  {
+  unsigned long length = 0;
+  unsigned long first, last;
+
+  for (byte i = 0; i < getRangeCount (); i++)
+    {
+    if (!getRange (i, totalLength, first, last))
+      continue;
+    length += out.print (F("\r\n--" RANGE_BOUNDARY "\r\nContent-Type: "));
+    length += out.print (contentType);
+    length += out.print (F("\r\nContent-Range: bytes "));
+    length += out.print (first);
+    length += out.print ('-');
+    length += out.print (last);
+    length += out.print ('/');
+    length += out.print (totalLength);
+    length += out.print (F("\r\n\r\n"));
+    length += last - first + 1;
+    if (withData)
+      sendRangeData (first, last, data);
+    } // end of for each range
+
+  length += out.print (F("\r\n--" RANGE_BOUNDARY "--\r\n"));
+  return length;
+  } // end of HTTPserver::sendByteranges
+
+// ---------------------------------------------------------------------------
+//  beginRangeResponse - status line and headers for the wanted range(s)
+// ---------------------------------------------------------------------------
+int HTTPserver::beginRangeResponse (const unsigned long totalLength, const char * contentType)
+  {
+  int status;
+  byte count = countRanges (totalLength);
+  unsigned long first, last;
+
+  // no Range header (or If-Range did not match): whole resource
+  if (getRangeCount () == 0)
+    {
+    status = 200;
+    println (F("HTTP/1.1 200 OK"));
+    print (F("Content-Type: "));
+    println (contentType);
+    print (F("Content-Length: "));
+    println (totalLength);
+    }
+  // none of them can be satisfied
+  else if (count == 0)
+    {
+    status = 416;
+    println (F("HTTP/1.1 416 Range Not Satisfiable"));
+    print (F("Content-Range: bytes */"));
+    println (totalLength);
+    println (F("Content-Length: 0"));
+    }
+  // one range: just that part
+  else if (count == 1)
+    {
+    status = 206;
+    for (byte i = 0; !getRange (i, totalLength, first, last); i++)
+      { }  // find it
+    println (F("HTTP/1.1 206 Partial Content"));
+    print (F("Content-Type: "));
+    println (contentType);
+    print (F("Content-Range: bytes "));
+    print (first);
+    print ('-');
+    print (last);
+    print ('/');
+    println (totalLength);
+    print (F("Content-Length: "));
+    println (last - first + 1);
+    }
+  // several ranges: multipart/byteranges
+  else
+    {
+    status = 206;
+    NullPrint counter;
+    println (F("HTTP/1.1 206 Partial Content"));
+    println (F("Content-Type: multipart/byteranges; boundary=" RANGE_BOUNDARY));
+    print (F("Content-Length: "));
+    println (sendByteranges (counter, totalLength, contentType, NULL, false));
+    }
+
+  println (F("Accept-Ranges: bytes"));
+  return status;
+  } // end of HTTPserver::beginRangeResponse
+
+// ---------------------------------------------------------------------------
+//  sendRangeBody - output the wanted range(s) of the resource
+// ---------------------------------------------------------------------------
+void HTTPserver::sendRangeBody (const unsigned long totalLength, const char * contentType, const byte * data)
+  {
+  byte count = countRanges (totalLength);
+  unsigned long first, last;
+
+  // whole resource
+  if (getRangeCount () == 0)
+    {
+    if (totalLength > 0)
+      sendRangeData (0, totalLength - 1, data);
+    }
+  // one range: just that part
+  else if (count == 1)
+    {
+    for (byte i = 0; !getRange (i, totalLength, first, last); i++)
+      { }  // find it
+    sendRangeData (first, last, data);
+    }
+  // several ranges: multipart/byteranges
+  else if (count > 1)
+    sendByteranges (*this, totalLength, contentType, data, true);
+
+  flush ();
+  } // end of HTTPserver::sendRangeBody
+
+// ---------------------------------------------------------------------------
+//  handleWebSocketHeader - note headers which ask for a WebSocket upgrade
+// ---------------------------------------------------------------------------
+void HTTPserver::handleWebSocketHeader (const char * key, const char * value)
+  {
+  // Upgrade: websocket
+  if (strcasecmp (key, "Upgrade") == 0 && strcasecmp (value, "websocket") == 0)
+    webSocketHandshake |= WS_GOT_UPGRADE;
+  // Connection: keep-alive, Upgrade
+  else if (strcasecmp (key, "Connection") == 0 && strcasestr (value, "upgrade"))
+    webSocketHandshake |= WS_GOT_CONNECTION;
+  // Sec-WebSocket-Version: 13
+  else if (strcasecmp (key, "Sec-WebSocket-Version") == 0 && atoi (value) == 13)
+    webSocketHandshake |= WS_GOT_VERSION;
+  // Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==
+  else if (strcasecmp (key, "Sec-WebSocket-Key") == 0)
+    {
+    // work out the accept value now, so we don't need to keep the key
+    Sha1Type sha;
+    sha1Init (sha);
+    for (const char * p = value; *p; p++)
+      sha1Add (sha, *p);
+    for (byte i = 0; i < sizeof WEBSOCKET_GUID - 1; i++)
+      sha1Add (sha, pgm_read_byte (&WEBSOCKET_GUID [i]));
+    sha1Final (sha, webSocketAccept);
+    webSocketHandshake |= WS_GOT_KEY;
+    }
+  } // end of HTTPserver::handleWebSocketHeader
+
+// ---------------------------------------------------------------------------
+//  sendWebSocketHandshake - agree to switch to the WebSocket protocol
+// ---------------------------------------------------------------------------
+void HTTPserver::sendWebSocketHandshake ()
+  {
+  static const char base64 [] PROGMEM = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  println (F("HTTP/1.1 101 Switching Protocols"));
+  println (F("Upgrade: websocket"));
+  println (F("Connection: Upgrade"));
+  print (F("Sec-WebSocket-Accept: "));
+
+  // base64-encode the 20-byte SHA-1 (the last group has only 2 bytes)
+  for (byte i = 0; i < sizeof webSocketAccept; i += 3)
+    {
+    uint32_t group = ((uint32_t) webSocketAccept [i] << 16) | ((uint32_t) webSocketAccept [i + 1] << 8);
+    if (i + 2U < sizeof webSocketAccept)
+      group |= webSocketAccept [i + 2];
+    write (pgm_read_byte (&base64 [(group >> 18) & 0x3F]));
+    write (pgm_read_byte (&base64 [(group >> 12) & 0x3F]));
+    write (pgm_read_byte (&base64 [(group >> 6) & 0x3F]));
+    write (i + 2U < sizeof webSocketAccept ? pgm_read_byte (&base64 [group & 0x3F]) : '=');
+    } // end of for each group
+  println ();
+  println ();  // end of headers
+  flush ();
+  } // end of HTTPserver::sendWebSocketHandshake
+
+// ---------------------------------------------------------------------------
+//  sendWebSocketHeader - start an outgoing (unmasked) frame
+// ---------------------------------------------------------------------------
+void HTTPserver::sendWebSocketHeader (const byte opcode, const unsigned long length)
+  {
+  write (0x80 | opcode);  // FIN + opcode
+  if (length < 126)
+    write (length);
+  else if (length <= 0xFFFF)
+    {
+    write (126);
+    write (length >> 8);
+    write (length & 0xFF);
+    }
+  else
+    {
+    write (127);
+    for (byte i = 0; i < 4; i++)
+      write ((byte) 0);  // we don't send more than 4 GB
+    for (int shift = 24; shift >= 0; shift -= 8)
+      write ((length >> shift) & 0xFF);
+    }
+  } // end of HTTPserver::sendWebSocketHeader
+
+// ---------------------------------------------------------------------------
+//  handleWebSocket - one incoming byte of a WebSocket frame
+// ---------------------------------------------------------------------------
+void HTTPserver::handleWebSocket (const byte inByte)
+  {
+  switch (state)
+    {
+    // {FIN + opcode} MASK + length, [extended length], mask, payload
+    case WEBSOCKET_OPCODE:
+      // no extensions were agreed, so the RSV bits must be clear
+      if (inByte & 0x70)
+        {
+        closeWebSocket (1002);  // protocol error
+        return;
+        }
+      webSocketOpcode = inByte;
+      newState (WEBSOCKET_LENGTH);
+      break;
+
+    // FIN + opcode, {MASK + length}, [extended length], mask, payload
+    case WEBSOCKET_LENGTH:
+      // frames from the client must be masked
+      if (!(inByte & 0x80))
+        {
+        closeWebSocket (1002);  // protocol error
+        return;
+        }
+      contentLength = inByte & 0x7F;
+      webSocketCount = 0;
+      if (contentLength == 126)
+        webSocketCount = 2;
+      else if (contentLength == 127)
+        webSocketCount = 8;
+
+      if (webSocketCount)
+        {
+        contentLength = 0;
+        newState (WEBSOCKET_EXTENDED_LENGTH);
+        }
+      else
+        newState (WEBSOCKET_MASK);
+      break;
+
+    // FIN + opcode, MASK + length, {[extended length]}, mask, payload
+    case WEBSOCKET_EXTENDED_LENGTH:
+      // we can't handle more than 4 GB
+      if (webSocketCount > 4 && inByte)
+        {
+        closeWebSocket (1009);  // message too big
+        return;
+        }
+      contentLength = (contentLength << 8) | inByte;
+      if (--webSocketCount == 0)
+        newState (WEBSOCKET_MASK);
+      break;
+
+    // FIN + opcode, MASK + length, [extended length], {mask}, payload
+    case WEBSOCKET_MASK:
+      webSocketMask [webSocketCount++] = inByte;
+      if (webSocketCount >= sizeof webSocketMask)
+        startWebSocketPayload ();
+      break;
+
+    // FIN + opcode, MASK + length, [extended length], mask, {payload}
+    case WEBSOCKET_PAYLOAD:
+      handleWebSocketPayload (&inByte, 1);
+      break;
+
+    default:
+      break;  // can't happen
+
+    } // end of switch on state
+
+  } // end of HTTPserver::handleWebSocket
+
+// ---------------------------------------------------------------------------
+//  startWebSocketPayload - frame header is complete, check it
+// ---------------------------------------------------------------------------
+void HTTPserver::startWebSocketPayload ()
+  {
+  const byte opcode = webSocketOpcode & 0x0F;
+
+  receivedLength = 0;
+  valueBufferPos = 0;
+
+  switch (opcode)
+    {
+    // a new message: remember if text or binary for any continuation frames
+    case WS_TEXT:
+    case WS_BINARY:
+      // can't start a new message in the middle of a fragmented one
+      if (webSocketFragmented)
+        {
+        closeWebSocket (1002);  // protocol error
+        return;
+        }
+      webSocketText = opcode == WS_TEXT;
+      webSocketFragmented = !(webSocketOpcode & 0x80);
+      break;
+
+    // more of a fragmented message
+    case WS_CONTINUATION:
+      if (!webSocketFragmented)
+        {
+        closeWebSocket (1002);  // protocol error - nothing to continue
+        return;
+        }
+      webSocketFragmented = !(webSocketOpcode & 0x80);
+      break;
+
+    // control frames: must not be fragmented, nor longer than 125 bytes
+    // (a Close payload, if any, starts with a 2-byte status code)
+    case WS_CLOSE:
+    case WS_PING:
+    case WS_PONG:
+      if (!(webSocketOpcode & 0x80) || contentLength > sizeof webSocketControl ||
+          (opcode == WS_CLOSE && contentLength == 1))
+        {
+        closeWebSocket (1002);  // protocol error
+        return;
+        }
+      break;
+
+    default:
+      closeWebSocket (1002);  // unknown opcode
+      return;
+    } // end of switch on opcode
+
+  newState (WEBSOCKET_PAYLOAD);
+  if (contentLength == 0)
+    {
+    if (webSocketOpcode & 0x08)
+      endWebSocketControl ();
+    else
+      endWebSocketChunk (true);
+    }
+  } // end of HTTPserver::startWebSocketPayload
+
+// ---------------------------------------------------------------------------
+//  handleWebSocketPayload - unmask payload bytes and pass them on
+// ---------------------------------------------------------------------------
+void HTTPserver::handleWebSocketPayload (const byte * data, size_t length)
+  {
+  // control frames are kept whole, so the reply can't be split by anything we send
+  if (webSocketOpcode & 0x08)
+    {
+    while (length-- > 0)
+      {
+      webSocketControl [receivedLength] = *data++ ^ webSocketMask [receivedLength & 3];
+      receivedLength++;
+      }
+    if (receivedLength >= contentLength)
+      endWebSocketControl ();
+    return;
+    }
+
+  // the header buffers are not needed once upgraded, so unmask into the value buffer
+  byte * buffer = (byte *) valueBuffer;
+
+  while (length > 0)
+    {
+    while (length > 0 && valueBufferPos < MAX_VALUE_LENGTH)
+      {
+      buffer [valueBufferPos++] = *data++ ^ webSocketMask [receivedLength++ & 3];
+      length--;
+      }
+
+    if (receivedLength >= contentLength)
+      endWebSocketChunk (true);
+    else if (valueBufferPos >= MAX_VALUE_LENGTH)
+      endWebSocketChunk (false);
+    } // end of while
+  } // end of HTTPserver::handleWebSocketPayload
+
+// ---------------------------------------------------------------------------
+//  endWebSocketChunk - deal with unmasked data payload in the value buffer
+// ---------------------------------------------------------------------------
+void HTTPserver::endWebSocketChunk (const bool endOfFrame)
+  {
+  byte dataFlags = webSocketText ? FLAG_WEBSOCKET_TEXT : FLAG_NONE;
+  if (endOfFrame && (webSocketOpcode & 0x80))
+    dataFlags |= FLAG_WEBSOCKET_FINAL;
+  processWebSocketData ((const byte *) valueBuffer, valueBufferPos, dataFlags);
+
+  valueBufferPos = 0;
+
+  // frame done, get ready for the next one
+  if (endOfFrame)
+    newState (WEBSOCKET_OPCODE);
+  } // end of HTTPserver::endWebSocketChunk
+
+// ---------------------------------------------------------------------------
+//  endWebSocketControl - answer a complete Ping or Close frame
+// ---------------------------------------------------------------------------
+void HTTPserver::endWebSocketControl ()
+  {
+  const byte opcode = webSocketOpcode & 0x0F;
+
+  newState (WEBSOCKET_OPCODE);
+
+  // echo the payload back in our Pong or Close frame, all in one go
+  switch (opcode)
+    {
+    case WS_PING:
+      sendWebSocketHeader (WS_PONG, contentLength);
+      write (webSocketControl, contentLength);
+      flush ();
+      break;
+
+    case WS_CLOSE:
+      sendWebSocketHeader (WS_CLOSE, contentLength);
+      write (webSocketControl, contentLength);
+      flush ();
+      done = true;
+      break;
+
+    default:
+      break;  // ignore Pong
+    } // end of switch on opcode
+  } // end of HTTPserver::endWebSocketControl
+
+// ---------------------------------------------------------------------------
+//  sendWebSocketText - send a text message
+// ---------------------------------------------------------------------------
+void HTTPserver::sendWebSocketText (const char * message)
+  {
+  sendWebSocketHeader (WS_TEXT, strlen (message));
+  print (message);
+  flush ();
+  } // end of HTTPserver::sendWebSocketText
+
+// ---------------------------------------------------------------------------
+//  sendWebSocketBinary - send a binary message
+// ---------------------------------------------------------------------------
+void HTTPserver::sendWebSocketBinary (const byte * data, const size_t length)
+  {
+  sendWebSocketHeader (WS_BINARY, length);
+  flush ();
+  if (output)
+    output->write (data, length);
+  } // end of HTTPserver::sendWebSocketBinary
+
+// ---------------------------------------------------------------------------
+//  beginWebSocketMessage - send a frame header, the caller prints the payload
+// ---------------------------------------------------------------------------
+void HTTPserver::beginWebSocketMessage (const unsigned long length, const bool text)
+  {
+  sendWebSocketHeader (text ? WS_TEXT : WS_BINARY, length);
+  } // end of HTTPserver::beginWebSocketMessage
+
+// ---------------------------------------------------------------------------
+//  closeWebSocket - send a Close frame with a status code, and stop
+// ---------------------------------------------------------------------------
+void HTTPserver::closeWebSocket (const unsigned int status)
+  {
+  sendWebSocketHeader (WS_CLOSE, 2);
+  write (status >> 8);
+  write (status & 0xFF);
+  flush ();
+  done = true;
+  } // end of HTTPserver::closeWebSocket
+
+// ---------------------------------------------------------------------------
+//  beginEventStream - headers for a Server-Sent Events response
+// ---------------------------------------------------------------------------
+void HTTPserver::beginEventStream (const unsigned long retry)
+  {
+  println (F("HTTP/1.1 200 OK"));
+  println (F("Content-Type: text/event-stream"));
+  println (F("Cache-Control: no-cache"));
+  println (F("Connection: keep-alive"));
+  println ();  // end of headers
+
+  // how long the browser should wait before reconnecting
+  if (retry)
+    {
+    print (F("retry: "));
+    print (retry);
+    print (F("\n\n"));
+    }
+
+  flush ();
+  eventStream = true;
+  lastEventTime = millis ();
+  } // end of HTTPserver::beginEventStream
+
+// ---------------------------------------------------------------------------
+//  beginEvent - event name and id (if any), and start the data
+// ---------------------------------------------------------------------------
+void HTTPserver::beginEvent (const char * event, const char * id)
+  {
+  if (event)
+    {
+    print (F("event: "));
+    print (event);
+    print ('\n');
+    }
+  if (id)
+    {
+    print (F("id: "));
+    print (id);
+    print ('\n');
+    }
+  print (F("data: "));
+  eventData = true;
+  eventNewline = false;
+  } // end of HTTPserver::beginEvent
+
+// ---------------------------------------------------------------------------
+//  endEvent - finish the event and send it straight away
+// ---------------------------------------------------------------------------
+void HTTPserver::endEvent ()
+  {
+  eventData = false;
+  eventNewline = false;  // a trailing newline is dropped
+  print (F("\n\n"));
+  flush ();
+  lastEventTime = millis ();
+  } // end of HTTPserver::endEvent
+
+// ---------------------------------------------------------------------------
+//  sendEvent - send a complete event
+// ---------------------------------------------------------------------------
+void HTTPserver::sendEvent (const char * data, const char * event, const char * id)
+  {
+  beginEvent (event, id);
+  print (data);
+  endEvent ();
+  } // end of HTTPserver::sendEvent
+
+// ---------------------------------------------------------------------------
+//  sendEventKeepAlive - a comment line stops proxies timing out the stream
+// ---------------------------------------------------------------------------
+void HTTPserver::sendEventKeepAlive (const unsigned long interval)
+  {
+  if (!eventStream || eventData || millis () - lastEventTime < interval)
+    return;
+
+  print (F(": keepalive\n\n"));
+  flush ();
+  lastEventTime = millis ();
+  } // end of HTTPserver::sendEventKeepAlive
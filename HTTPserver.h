@@ -5,8 +5,9 @@ class HTTPserver : public Print
   protected:
   static const size_t MAX_KEY_LENGTH = 40;     // maximum size for a key
   static const size_t MAX_VALUE_LENGTH = 100;  // maximum size for a value
-  static const size_t BODY_CHUNK_LENGTH = 16;  // maximum size for a binary body chunk
+  static const size_t BODY_CHUNK_LENGTH = 16;  // binary body chunk size from processIncomingByte (processIncomingBytes may pass more)
   static const size_t SEND_BUFFER_LENGTH = 64; // how much to buffer sends
+  static const byte MAX_RANGES = 4;            // maximum byte ranges kept from a Range header
 
   private:
   char keyBuffer [MAX_KEY_LENGTH + 1];      // store here
@@ -21,6 +22,45 @@ class HTTPserver : public Print
   char sendBuffer [SEND_BUFFER_LENGTH];     // for buffering output
   size_t sendBufferPos;                     // how much in buffer
 
+  // a byte range from a Range header
+  enum {
+    RANGE_SUFFIX = 0x01,  // eg. -500 (first not used, last is the suffix length)
+    RANGE_TO_END = 0x02,  // eg. 1000- (last not used)
+  };
+  struct RangeType {
+    unsigned long first;
+    unsigned long last;
+    byte type;            // see above enum
+  };
+
+  RangeType ranges [MAX_RANGES];            // requested ranges
+  byte rangeCount;                          // how many
+  bool ifRangeFailed;                       // If-Range did not match, send everything
+
+  // WebSocket upgrade: which handshake headers we have seen (bitmask)
+  enum {
+    WS_GOT_UPGRADE    = 0x01,   // Upgrade: websocket
+    WS_GOT_CONNECTION = 0x02,   // Connection: Upgrade
+    WS_GOT_KEY        = 0x04,   // Sec-WebSocket-Key: xxx
+    WS_GOT_VERSION    = 0x08,   // Sec-WebSocket-Version: 13
+    WS_GOT_ALL        = 0x0F,
+  };
+  byte webSocketHandshake;                  // see above enum
+  byte webSocketAccept [20];                // SHA-1 of key and GUID, for Sec-WebSocket-Accept
+
+  // WebSocket frame decoding
+  byte webSocketOpcode;                     // FIN flag and opcode of the current frame
+  bool webSocketText;                       // current data message is text
+  bool webSocketFragmented;                 // data message started, but its final frame not yet seen
+  byte webSocketMask [4];                   // masking key of the current frame
+  byte webSocketCount;                      // length or mask bytes still to come / collected
+  byte webSocketControl [125];              // Ping or Close payload, answered once the frame is complete
+
+  // Server-Sent Events
+  bool eventData;                           // inside the data of an event
+  bool eventNewline;                        // newline in event data, "data:" prefix pending
+  unsigned long lastEventTime;              // millis () when we last sent something
+
   // state machine: possible states
   enum StateType {
     SKIP_INITIAL_LINES, // skip blank lines before the GET line
@@ -42,6 +82,11 @@ class HTTPserver : public Print
     POST_NAME,          // eg. action
     POST_VALUE,         // eg. add
     BODY,               // eg. octet-stream binary blob
+    WEBSOCKET_OPCODE,          // WebSocket frame: FIN flag and opcode
+    WEBSOCKET_LENGTH,          // WebSocket frame: MASK flag and 7-bit length
+    WEBSOCKET_EXTENDED_LENGTH, // WebSocket frame: 16 or 64-bit length
+    WEBSOCKET_MASK,            // WebSocket frame: 4-byte masking key
+    WEBSOCKET_PAYLOAD,         // WebSocket frame: (masked) payload
   };
   // current state
   StateType state;
@@ -66,6 +111,8 @@ class HTTPserver : public Print
       FLAG_KEY_BUFFER_OVERFLOW    = 0x01,    // the key was truncated
       FLAG_VALUE_BUFFER_OVERFLOW  = 0x02,    // the value was truncated
       FLAG_ENCODING_ERROR         = 0x04,    // %xx encoding error
+      FLAG_WEBSOCKET_TEXT         = 0x08,    // WebSocket data is a text (not binary) message
+      FLAG_WEBSOCKET_FINAL        = 0x10,    // last WebSocket data of this message
     };
 
     bool postRequest; // true if a POST type
@@ -77,6 +124,7 @@ class HTTPserver : public Print
   unsigned long contentLength;   // how long the POST data is
   unsigned long receivedLength;  // how much POST data we currently have
   Print * output;  // where to write output to
+  Print * bodySink;  // where to write a binary body to (NULL = processBodyChunk)
 
   // private methods (just used internally)
 
@@ -86,11 +134,28 @@ class HTTPserver : public Print
   void addToKeyBuffer (const byte inByte);
   void addToValueBuffer (byte inByte, const bool percentEncoded);
   void addToBodyBuffer (const byte inByte);
+  void flushBodyBuffer ();
+  void deliverBody (const byte * data, const size_t length);
   void clearBuffers ();
   // state handlers
   void handleNewline ();
   void handleSpace ();
   void handleText (const byte inByte);
+  // byte ranges
+  void parseRange (const char * value);
+  byte countRanges (const unsigned long totalLength);
+  void sendRangeData (const unsigned long first, const unsigned long last, const byte * data);
+  unsigned long sendByteranges (Print & out, const unsigned long totalLength, const char * contentType,
+                                const byte * data, const bool withData);
+  // WebSocket
+  void handleWebSocketHeader (const char * key, const char * value);
+  void sendWebSocketHandshake ();
+  void sendWebSocketHeader (const byte opcode, const unsigned long length);
+  void handleWebSocket (const byte inByte);
+  void startWebSocketPayload ();
+  void handleWebSocketPayload (const byte * data, size_t length);
+  void endWebSocketChunk (const bool endOfFrame);
+  void endWebSocketControl ();
 
   public:
 
@@ -103,6 +168,20 @@ class HTTPserver : public Print
     // handle one incoming byte from the client
     void processIncomingByte (const byte inByte);
 
+    // handle a buffer of incoming bytes, returns how many were used (stops when done)
+    size_t processIncomingBytes (const byte * data, const size_t length);
+
+    // send a binary body straight to sink (eg. a File) rather than to processBodyChunk
+    void setBodySink (Print * sink) { bodySink = sink; }
+    // true if the body sink did not take all the data (eg. disk full) - done is set too
+    bool bodySinkFailed;
+
+    // bytes of binary body still to come - application can move them itself
+    // (eg. with splice on Linux) and then report them with bodyReceived
+    // (anything already buffered is passed on first, so it stays in order)
+    unsigned long getBodyRemaining ();
+    void bodyReceived (unsigned long count);
+
     // empty sending buffer
     void flush ();  // for emptying send buffer
     
@@ -113,6 +192,18 @@ class HTTPserver : public Print
     // set to stop further processing (eg. on error)
     bool done;
 
+    // true while a handler has deferred its response (see defer)
+    bool deferred;
+
+    // true once the connection has been upgraded to a WebSocket
+    bool webSocket;
+
+    // true once beginEventStream has been called
+    bool eventStream;
+
+    // give a deferred response a chance to continue - call from your main loop
+    void poll ();
+
     // true if "Content-Type" header is "application/octet-stream" OR application can set for other relevant type(s)
     bool binaryBody;
 
@@ -126,8 +217,28 @@ class HTTPserver : public Print
     virtual void processHeaderArgument  (const char * key, const char * value, const byte flags) { }
     virtual void processCookie          (const char * key, const char * value, const byte flags) { }
     virtual void processPostArgument    (const char * key, const char * value, const byte flags) { }
+    // (length can be as large as the buffer given to processIncomingBytes)
     virtual void processBodyChunk       (const byte * data, const size_t length, const byte flags) { }
 
+    // If-Range value - return true if it matches the resource (ETag or date), otherwise the whole resource is sent
+    virtual bool processIfRange         (const char * value, const byte flags) { return false; }
+    // supply resource data for sendRangeBody (when no memory buffer given) - return bytes read
+    virtual size_t readResource         (const unsigned long offset, byte * buffer, const size_t length) { return 0; }
+
+    // WebSocket upgrade requested - return true to accept it
+    virtual bool acceptWebSocket        () { return false; }
+    // incoming WebSocket message data (unmasked) - see FLAG_WEBSOCKET_TEXT / FLAG_WEBSOCKET_FINAL
+    virtual void processWebSocketData   (const byte * data, const size_t length, const byte flags) { }
+
+    // Last-Event-ID header - the client is resuming an event stream
+    virtual void processLastEventId     (const char * value, const byte flags) { }
+
+    // called by poll () while deferred - return true when the response is complete
+    virtual bool processDeferredResponse () { return true; }
+
+    // call from a handler to finish the response later (from processDeferredResponse)
+    void defer () { deferred = true; }
+
     // for outputting back to client
   	size_t write(uint8_t c);
 
@@ -139,5 +250,32 @@ class HTTPserver : public Print
     // output a Set-Cookie header line
     void setCookie (const char * name, const char * value, const char * extra = NULL);
 
+    // number of byte ranges wanted by the client (0 = send the whole resource)
+    byte getRangeCount () { return ifRangeFailed ? 0 : rangeCount; }
+    // work out byte range (which) for a resource of totalLength, false if not satisfiable
+    bool getRange (const byte which, const unsigned long totalLength, unsigned long & first, unsigned long & last);
+    // output status line and headers for a (possibly partial) response - returns status code (200, 206 or 416)
+    int beginRangeResponse (const unsigned long totalLength, const char * contentType);
+    // output the wanted part(s) of the resource, from data or (if NULL) readResource
+    void sendRangeBody (const unsigned long totalLength, const char * contentType, const byte * data = NULL);
+
+    // send a WebSocket text or binary message
+    void sendWebSocketText (const char * message);
+    void sendWebSocketBinary (const byte * data, const size_t length);
+    // start a WebSocket message - then print exactly length bytes, and flush
+    void beginWebSocketMessage (const unsigned long length, const bool text = true);
+    // send a WebSocket close frame and stop processing (sets done)
+    void closeWebSocket (const unsigned int status = 1000);
+
+    // output headers for a text/event-stream response (retry: reconnection time in ms, 0 = browser default)
+    void beginEventStream (const unsigned long retry = 0);
+    // send a complete event
+    void sendEvent (const char * data, const char * event = NULL, const char * id = NULL);
+    // start an event - then print the data (newlines are allowed) and call endEvent
+    void beginEvent (const char * event = NULL, const char * id = NULL);
+    void endEvent ();
+    // send a keepalive comment if nothing was sent for interval ms - call from your main loop
+    void sendEventKeepAlive (const unsigned long interval);
+
     using Print::write;
   };  // end of HTTPserver
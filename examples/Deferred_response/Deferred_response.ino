@@ -0,0 +1,128 @@
+// Tiny web server demo - deferred responses with several clients at once
+
+#include <SPI.h>
+#include <Ethernet.h>
+#include <HTTPserver.h>
+
+// Enter a MAC address and IP address for your controller below.
+byte mac[] = {  0x90, 0xA2, 0xDA, 0x00, 0x2D, 0xA1 };
+
+// The IP address will be dependent on your local network:
+byte ip[] = { 10, 0, 0, 241 };
+
+// the router's gateway address:
+byte gateway[] = { 10, 0, 0, 1 };
+
+// the subnet mask
+byte subnet[] = { 255, 255, 255, 0 };
+
+// Initialize the Ethernet server library
+EthernetServer server(80);
+
+// how long our pretend sensor takes to give a reading
+const unsigned long CONVERSION_TIME = 750;  // milliseconds
+
+// derive an instance of the HTTPserver class with custom handlers
+class myServerClass : public HTTPserver
+  {
+  virtual void processPathname        (const char * key, const byte flags);
+  virtual bool processDeferredResponse ();
+
+  unsigned long conversionStarted;  // when we asked the sensor for a reading
+  };  // end of myServerClass
+
+// one server instance (and client) per connection
+const int MAX_CLIENTS = 4;
+myServerClass myServer [MAX_CLIENTS];
+EthernetClient clients [MAX_CLIENTS];
+
+// -----------------------------------------------
+//  User handlers
+// -----------------------------------------------
+
+void myServerClass::processPathname (const char * key, const byte flags)
+  {
+  println(F("HTTP/1.1 200 OK"));
+  println(F("Content-Type: text/plain\n"
+            "Connection: close\n"
+            "Server: HTTPserver/1.0.0 (Arduino)"));
+  println();  // end of headers
+
+  // slow request: start the conversion and answer later
+  if (strcmp (key, "/temperature") == 0)
+    {
+    conversionStarted = millis ();
+    defer ();
+    return;
+    }
+
+  // fast request: answer straight away
+  print (F("Uptime: "));
+  println (millis ());
+  }  // end of processPathname
+
+bool myServerClass::processDeferredResponse ()
+  {
+  // not ready yet? try again next time around loop
+  if (millis () - conversionStarted < CONVERSION_TIME)
+    return false;
+
+  print (F("Temperature: "));
+  println (analogRead (A0));
+  return true;  // response complete
+  }  // end of processDeferredResponse
+
+// -----------------------------------------------
+//  End of user handlers
+// -----------------------------------------------
+
+void setup ()
+  {
+  // start the Ethernet connection and the server:
+  Ethernet.begin(mac, ip, gateway, subnet);
+  server.begin();
+  }  // end of setup
+
+void loop ()
+  {
+  // look for a new connection, and give it a free slot
+  EthernetClient newClient = server.accept();
+  if (newClient)
+    {
+    for (int i = 0; i < MAX_CLIENTS; i++)
+      if (!clients [i])
+        {
+        clients [i] = newClient;
+        myServer [i].begin (&clients [i]);
+        newClient = EthernetClient ();
+        break;
+        }
+    // no free slot? turn it away
+    if (newClient)
+      newClient.stop();
+    }  // end of new client
+
+  // service each connection in turn - never wait for any of them
+  for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+    EthernetClient & client = clients [i];
+    if (!client)
+      continue;
+
+    while (client.available () > 0 && !myServer [i].done)
+      myServer [i].processIncomingByte (client.read ());
+
+    myServer [i].poll ();
+
+    // finished? (request all read and response not deferred)
+    if (!client.connected() || (myServer [i].done && !myServer [i].deferred))
+      {
+      myServer [i].flush ();
+      // give the web browser time to receive the data
+      delay(1);
+      // close the connection:
+      client.stop();
+      }
+    }  // end of for each client
+
+  }  // end of loop
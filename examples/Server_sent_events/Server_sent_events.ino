@@ -0,0 +1,171 @@
+// Tiny web server demo - push readings to several browsers with Server-Sent Events
+
+#include <SPI.h>
+#include <Ethernet.h>
+#include <HTTPserver.h>
+
+// Enter a MAC address and IP address for your controller below.
+byte mac[] = {  0x90, 0xA2, 0xDA, 0x00, 0x2D, 0xA1 };
+
+// The IP address will be dependent on your local network:
+byte ip[] = { 10, 0, 0, 241 };
+
+// the router's gateway address:
+byte gateway[] = { 10, 0, 0, 1 };
+
+// the subnet mask
+byte subnet[] = { 255, 255, 255, 0 };
+
+// Initialize the Ethernet server library
+EthernetServer server(80);
+
+// how often to send a reading, and a keepalive if idle
+const unsigned long UPDATE_INTERVAL = 1000;      // milliseconds
+const unsigned long KEEPALIVE_INTERVAL = 15000;  // milliseconds
+
+// event id of the latest reading
+unsigned long readingNumber;
+
+// derive an instance of the HTTPserver class with custom handlers
+class myServerClass : public HTTPserver
+  {
+  virtual void processPathname        (const char * key, const byte flags);
+  virtual void processLastEventId     (const char * value, const byte flags);
+
+  public:
+    bool events;              // they asked for /events
+    unsigned long resumeFrom; // last event id they saw (0 = new)
+  };  // end of myServerClass
+
+// one server instance (and client) per connection
+const int MAX_CLIENTS = 4;
+myServerClass myServer [MAX_CLIENTS];
+EthernetClient clients [MAX_CLIENTS];
+
+// -----------------------------------------------
+//  User handlers
+// -----------------------------------------------
+
+void myServerClass::processPathname (const char * key, const byte flags)
+  {
+  events = strcmp (key, "/events") == 0;
+  resumeFrom = 0;
+  if (events)
+    return;  // start the stream when all headers are in
+
+  // anything else gets the page which listens for events
+  println(F("HTTP/1.1 200 OK"));
+  println(F("Content-Type: text/html\n"
+            "Connection: close\n"
+            "Server: HTTPserver/1.0.0 (Arduino)"));
+  println();  // end of headers
+
+  println(F("<html><body><p>Reading: <span id=\"reading\">?</span></p>\n"
+            "<script>\n"
+            "var source = new EventSource ('/events');\n"
+            "source.addEventListener ('reading', function (e) {\n"
+            "  document.getElementById ('reading').textContent = e.data; });\n"
+            "</script></body></html>"));
+  }  // end of processPathname
+
+void myServerClass::processLastEventId (const char * value, const byte flags)
+  {
+  resumeFrom = atol (value);
+  }  // end of processLastEventId
+
+// -----------------------------------------------
+//  End of user handlers
+// -----------------------------------------------
+
+void setup ()
+  {
+  // start the Ethernet connection and the server:
+  Ethernet.begin(mac, ip, gateway, subnet);
+  server.begin();
+  }  // end of setup
+
+void loop ()
+  {
+  static unsigned long lastUpdate;
+
+  // look for a new connection, and give it a free slot
+  EthernetClient newClient = server.accept();
+  if (newClient)
+    {
+    for (int i = 0; i < MAX_CLIENTS; i++)
+      if (!clients [i])
+        {
+        clients [i] = newClient;
+        myServer [i].begin (&clients [i]);
+        newClient = EthernetClient ();
+        break;
+        }
+    // no free slot? turn it away
+    if (newClient)
+      newClient.stop();
+    }  // end of new client
+
+  // time for a new reading?
+  bool update = millis () - lastUpdate >= UPDATE_INTERVAL;
+  char reading [12];
+  char id [12];
+  if (update)
+    {
+    lastUpdate = millis ();
+    readingNumber++;
+    itoa (analogRead (A0), reading, 10);
+    ultoa (readingNumber, id, 10);
+    }
+
+  // service each connection in turn
+  for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+    EthernetClient & client = clients [i];
+    if (!client)
+      continue;
+
+    while (client.available () > 0 && !myServer [i].done)
+      myServer [i].processIncomingByte (client.read ());
+
+    // request is in: start the event stream, or close after sending the page
+    if (myServer [i].done && !myServer [i].eventStream)
+      {
+      if (myServer [i].events)
+        {
+        myServer [i].beginEventStream (5000);
+        // (an id newer than ours means we have rebooted since - nothing to report)
+        if (myServer [i].resumeFrom && myServer [i].resumeFrom <= readingNumber)
+          {
+          // tell them how many readings they missed
+          myServer [i].beginEvent ("missed");
+          myServer [i].print (readingNumber - myServer [i].resumeFrom);
+          myServer [i].endEvent ();
+          }
+        }
+      else
+        {
+        myServer [i].flush ();
+        // give the web browser time to receive the data
+        delay(1);
+        // close the connection:
+        client.stop();
+        continue;
+        }
+      }
+
+    if (!client.connected())
+      {
+      client.stop();
+      continue;
+      }
+
+    // fan out the reading to every browser listening
+    if (myServer [i].eventStream)
+      {
+      if (update)
+        myServer [i].sendEvent (reading, "reading", id);
+      myServer [i].sendEventKeepAlive (KEEPALIVE_INTERVAL);
+      }
+    }  // end of for each client
+
+  }  // end of loop
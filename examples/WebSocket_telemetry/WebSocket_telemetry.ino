@@ -0,0 +1,173 @@
+// Tiny web server demo - push readings to several browsers over WebSockets
+
+#include <SPI.h>
+#include <Ethernet.h>
+#include <HTTPserver.h>
+
+// Enter a MAC address and IP address for your controller below.
+byte mac[] = {  0x90, 0xA2, 0xDA, 0x00, 0x2D, 0xA1 };
+
+// The IP address will be dependent on your local network:
+byte ip[] = { 10, 0, 0, 241 };
+
+// the router's gateway address:
+byte gateway[] = { 10, 0, 0, 1 };
+
+// the subnet mask
+byte subnet[] = { 255, 255, 255, 0 };
+
+// Initialize the Ethernet server library
+EthernetServer server(80);
+
+// how often to send a reading
+const unsigned long UPDATE_INTERVAL = 1000;  // milliseconds
+
+// longest message from the browser we will echo back
+const size_t MAX_ECHO = 64;
+
+// derive an instance of the HTTPserver class with custom handlers
+class myServerClass : public HTTPserver
+  {
+  virtual void processPathname        (const char * key, const byte flags);
+  virtual bool acceptWebSocket        ();
+  virtual void processWebSocketData   (const byte * data, const size_t length, const byte flags);
+
+  bool telemetry;  // they asked for /telemetry
+
+  byte echoBuffer [MAX_ECHO];  // message collected so far
+  size_t echoLength;           // how much of it
+  bool echoTooLong;            // message didn't fit
+  };  // end of myServerClass
+
+// one server instance (and client) per connection
+// (each one takes over 500 bytes of RAM, so keep this small on a Uno)
+const int MAX_CLIENTS = 2;
+myServerClass myServer [MAX_CLIENTS];
+EthernetClient clients [MAX_CLIENTS];
+
+// -----------------------------------------------
+//  User handlers
+// -----------------------------------------------
+
+void myServerClass::processPathname (const char * key, const byte flags)
+  {
+  telemetry = strcmp (key, "/telemetry") == 0;
+  if (telemetry)
+    return;  // wait for the upgrade
+
+  // anything else gets the page which opens the WebSocket
+  println(F("HTTP/1.1 200 OK"));
+  println(F("Content-Type: text/html\n"
+            "Connection: close\n"
+            "Server: HTTPserver/1.0.0 (Arduino)"));
+  println();  // end of headers
+
+  println(F("<html><body><p>Reading: <span id=\"reading\">?</span></p>\n"
+            "<script>\n"
+            "var ws = new WebSocket ('ws://' + location.host + '/telemetry');\n"
+            "ws.onmessage = function (e) { document.getElementById ('reading').textContent = e.data; };\n"
+            "</script></body></html>"));
+  }  // end of processPathname
+
+bool myServerClass::acceptWebSocket ()
+  {
+  echoLength = 0;
+  echoTooLong = false;
+  return telemetry;
+  }  // end of acceptWebSocket
+
+void myServerClass::processWebSocketData (const byte * data, const size_t length, const byte flags)
+  {
+  // a text message from the browser arrives in chunks - collect them
+  if (!(flags & FLAG_WEBSOCKET_TEXT))
+    return;
+  if (echoLength + length <= MAX_ECHO)
+    {
+    memcpy (&echoBuffer [echoLength], data, length);
+    echoLength += length;
+    }
+  else
+    echoTooLong = true;
+
+  if (!(flags & FLAG_WEBSOCKET_FINAL))
+    return;
+
+  // whole message here - echo it back as a test (longer messages are not echoed)
+  if (!echoTooLong)
+    {
+    beginWebSocketMessage (echoLength);
+    write (echoBuffer, echoLength);
+    flush ();
+    }
+  echoLength = 0;
+  echoTooLong = false;
+  }  // end of processWebSocketData
+
+// -----------------------------------------------
+//  End of user handlers
+// -----------------------------------------------
+
+void setup ()
+  {
+  // start the Ethernet connection and the server:
+  Ethernet.begin(mac, ip, gateway, subnet);
+  server.begin();
+  }  // end of setup
+
+void loop ()
+  {
+  static unsigned long lastUpdate;
+
+  // look for a new connection, and give it a free slot
+  EthernetClient newClient = server.accept();
+  if (newClient)
+    {
+    for (int i = 0; i < MAX_CLIENTS; i++)
+      if (!clients [i])
+        {
+        clients [i] = newClient;
+        myServer [i].begin (&clients [i]);
+        newClient = EthernetClient ();
+        break;
+        }
+    // no free slot? turn it away
+    if (newClient)
+      newClient.stop();
+    }  // end of new client
+
+  // time for a new reading?
+  bool update = millis () - lastUpdate >= UPDATE_INTERVAL;
+  char reading [12];
+  if (update)
+    {
+    lastUpdate = millis ();
+    itoa (analogRead (A0), reading, 10);
+    }
+
+  // service each connection in turn - never wait for any of them
+  for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+    EthernetClient & client = clients [i];
+    if (!client)
+      continue;
+
+    while (client.available () > 0 && !myServer [i].done)
+      myServer [i].processIncomingByte (client.read ());
+
+    // finished? (page sent, WebSocket closed, or browser gone)
+    if (!client.connected() || myServer [i].done)
+      {
+      myServer [i].flush ();
+      // give the web browser time to receive the data
+      delay(1);
+      // close the connection:
+      client.stop();
+      continue;
+      }
+
+    // fan out the reading to every open WebSocket
+    if (update && myServer [i].webSocket)
+      myServer [i].sendWebSocketText (reading);
+    }  // end of for each client
+
+  }  // end of loop
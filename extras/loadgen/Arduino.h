@@ -0,0 +1,57 @@
+// Minimal Arduino.h stand-in, so HTTPserver can be compiled on a host
+// (Linux, macOS) for the load-generator benchmark. Only what the library
+// itself uses is provided.
+
+#ifndef ARDUINO_HOST_SHIM_H
+#define ARDUINO_HOST_SHIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+typedef uint8_t byte;
+
+// no separate flash address space on a host
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *) (p))
+
+unsigned long millis ();
+
+class Print
+  {
+  public:
+    virtual ~Print () { }
+
+    virtual size_t write (uint8_t c) = 0;
+    virtual size_t write (const uint8_t * buffer, size_t size)
+      {
+      size_t n = 0;
+      while (size--)
+        n += write (*buffer++);
+      return n;
+      }
+    size_t write (const char * str) { return str ? write ((const uint8_t *) str, strlen (str)) : 0; }
+    size_t write (const char * buffer, size_t size) { return write ((const uint8_t *) buffer, size); }
+
+    size_t print (const __FlashStringHelper * s) { return write ((const char *) s); }
+    size_t print (const char * s)     { return write (s); }
+    size_t print (char c)             { return write ((uint8_t) c); }
+    size_t print (unsigned long n)    { char buf [24]; snprintf (buf, sizeof buf, "%lu", n); return write (buf); }
+    size_t print (long n)             { char buf [24]; snprintf (buf, sizeof buf, "%ld", n); return write (buf); }
+    size_t print (unsigned int n)     { return print ((unsigned long) n); }
+    size_t print (int n)              { return print ((long) n); }
+
+    size_t println ()                 { return write ("\r\n"); }
+    template <typename T>
+    size_t println (T value)          { size_t n = print (value); return n + println (); }
+
+    virtual void flush () { }
+  };  // end of Print
+
+#endif // ARDUINO_HOST_SHIM_H
@@ -0,0 +1,215 @@
+// Loopback benchmark server built from the HTTPserver library.
+//
+// Serves every connection from a single poll() loop (like an Arduino
+// sketch's loop), with one HTTPserver instance per connection, so the
+// numbers reported by loadgen reflect the library's own parsing cost.
+//
+// See README.md in this directory for how to build and run it.
+
+#include <Arduino.h>
+#include <HTTPserver.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+unsigned long millis ()
+  {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+  }  // end of millis
+
+// Print which writes to a socket (blocking until all sent)
+class SocketPrint : public Print
+  {
+  public:
+    int fd;
+
+    size_t write (uint8_t c) { return write (&c, 1); }
+    size_t write (const uint8_t * buffer, size_t size)
+      {
+      size_t sent = 0;
+      while (sent < size)
+        {
+        ssize_t n = send (fd, buffer + sent, size - sent, MSG_NOSIGNAL);
+        if (n < 0)
+          {
+          if (errno == EINTR)
+            continue;
+          if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+            struct pollfd p = { fd, POLLOUT, 0 };
+            poll (&p, 1, 1000);
+            continue;
+            }
+          break;  // peer gone
+          }
+        sent += n;
+        }
+      return sent;
+      }
+    using Print::write;
+  };  // end of SocketPrint
+
+// counts what it was given and answers with a summary
+class benchServer : public HTTPserver
+  {
+  public:
+    unsigned long getArgs, headers, cookies, postArgs, bodyBytes;
+    bool closeWanted;
+
+    void reset (Print * out)
+      {
+      getArgs = headers = cookies = postArgs = bodyBytes = 0;
+      closeWanted = false;
+      begin (out);
+      }
+
+  protected:
+    virtual void processGetArgument    (const char * key, const char * value, const byte flags) { getArgs++; }
+    virtual void processCookie         (const char * key, const char * value, const byte flags) { cookies++; }
+    virtual void processPostArgument   (const char * key, const char * value, const byte flags) { postArgs++; }
+    virtual void processBodyChunk      (const byte * data, const size_t length, const byte flags) { bodyBytes += length; }
+    virtual void processHeaderArgument (const char * key, const char * value, const byte flags)
+      {
+      headers++;
+      if (strcasecmp (key, "Connection") == 0 && strcasecmp (value, "close") == 0)
+        closeWanted = true;
+      }
+  };  // end of benchServer
+
+struct connection
+  {
+  SocketPrint out;
+  benchServer server;
+  };
+
+static const int MAX_CONNECTIONS = 1024;
+
+// send the reply for a completed request
+static void respond (benchServer & server)
+  {
+  char body [128];
+  int length = snprintf (body, sizeof body, "ok get=%lu headers=%lu cookies=%lu post=%lu body=%lu\n",
+                         server.getArgs, server.headers, server.cookies, server.postArgs, server.bodyBytes);
+
+  server.println (F("HTTP/1.1 200 OK"));
+  server.println (F("Content-Type: text/plain"));
+  server.print   (F("Content-Length: "));
+  server.println (length);
+  server.println (server.closeWanted ? F("Connection: close") : F("Connection: keep-alive"));
+  server.println ();
+  server.print (body);
+  server.flush ();
+  }  // end of respond
+
+int main (int argc, char * argv [])
+  {
+  int port = argc > 1 ? atoi (argv [1]) : 8080;
+
+  signal (SIGPIPE, SIG_IGN);
+
+  int listener = socket (AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt (listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+  struct sockaddr_in addr;
+  memset (&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons (port);
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);  // loopback only
+
+  if (bind (listener, (struct sockaddr *) &addr, sizeof addr) < 0 || listen (listener, 128) < 0)
+    {
+    perror ("benchserver: bind/listen");
+    return 1;
+    }
+  fcntl (listener, F_SETFL, O_NONBLOCK);
+  fprintf (stderr, "benchserver: listening on 127.0.0.1:%d\n", port);
+
+  static struct pollfd fds [MAX_CONNECTIONS + 1];
+  static connection * conns [MAX_CONNECTIONS + 1];
+  int count = 1;
+  fds [0].fd = listener;
+  fds [0].events = POLLIN;
+
+  while (true)
+    {
+    if (poll (fds, count, -1) < 0)
+      {
+      if (errno == EINTR)
+        continue;
+      perror ("benchserver: poll");
+      return 1;
+      }
+
+    // new connections
+    if (fds [0].revents & POLLIN)
+      {
+      int fd;
+      while ((fd = accept (listener, NULL, NULL)) >= 0)
+        {
+        if (count > MAX_CONNECTIONS)
+          {
+          close (fd);
+          continue;
+          }
+        setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        fcntl (fd, F_SETFL, O_NONBLOCK);
+        connection * c = new connection;
+        c->out.fd = fd;
+        c->server.reset (&c->out);
+        fds [count].fd = fd;
+        fds [count].events = POLLIN;
+        fds [count].revents = 0;
+        conns [count] = c;
+        count++;
+        }
+      }  // end of new connections
+
+    // incoming data
+    for (int i = count - 1; i >= 1; i--)
+      {
+      if (!(fds [i].revents & (POLLIN | POLLHUP | POLLERR)))
+        continue;
+
+      connection * c = conns [i];
+      bool finished = false;
+      byte buf [4096];
+      ssize_t n = recv (fds [i].fd, buf, sizeof buf, 0);
+      if (n <= 0)
+        finished = !(n < 0 && (errno == EAGAIN || errno == EINTR));
+
+      for (ssize_t pos = 0; pos < n && !finished; )
+        {
+        pos += c->server.processIncomingBytes (&buf [pos], n - pos);
+        if (c->server.done)
+          {
+          respond (c->server);
+          if (c->server.closeWanted)
+            finished = true;
+          else
+            c->server.reset (&c->out);  // keep-alive: ready for the next request
+          }
+        }
+
+      if (finished)
+        {
+        close (fds [i].fd);
+        delete c;
+        count--;
+        fds [i] = fds [count];
+        conns [i] = conns [count];
+        }
+      }  // end of for each connection
+    }  // end of while
+
+  }  // end of main
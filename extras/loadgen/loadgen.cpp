@@ -0,0 +1,429 @@
+// Loopback load generator and latency benchmark for HTTPserver.
+//
+// Opens N concurrent connections to a server on 127.0.0.1, replays a
+// weighted mix of requests (GET with arguments, cookies, urlencoded POST,
+// octet-stream upload) with keep-alive or one connection per request, and
+// reports throughput plus a latency histogram and p50/p99/p999.
+//
+// See README.md in this directory for how to build and run it.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+typedef std::chrono::steady_clock Clock;
+
+// kinds of request we can send
+enum RequestType {
+  REQ_GET,      // GET with arguments
+  REQ_COOKIE,   // GET with cookies
+  REQ_POST,     // application/x-www-form-urlencoded
+  REQ_UPLOAD,   // application/octet-stream
+  REQ_TYPE_COUNT
+};
+
+static const char * requestNames [REQ_TYPE_COUNT] = { "get", "cookie", "post", "upload" };
+
+// what benchserver should report back for each kind of request
+struct Expected
+  {
+  unsigned long getArgs;
+  unsigned long cookies;
+  unsigned long postArgs;
+  unsigned long bodyBytes;
+  };
+
+struct Options
+  {
+  int port = 8080;
+  int connections = 8;
+  double duration = 5.0;          // seconds
+  bool keepAlive = true;
+  size_t uploadSize = 4096;       // bytes per octet-stream upload
+  double timeout = 5.0;           // seconds to wait on any one send or receive
+  int weights [REQ_TYPE_COUNT] = { 1, 1, 1, 1 };
+  };
+
+// per-thread results
+struct Results
+  {
+  std::vector<uint32_t> latencies;  // microseconds
+  unsigned long counts [REQ_TYPE_COUNT] = { 0 };
+  unsigned long errors = 0;
+  unsigned long long bytesSent = 0;
+  };
+
+static std::atomic<bool> stopping (false);
+
+static void usage ()
+  {
+  fprintf (stderr,
+    "usage: loadgen [options]\n"
+    "  -p PORT        server port on 127.0.0.1 (default 8080)\n"
+    "  -c N           concurrent connections (default 8)\n"
+    "  -d SECONDS     test duration (default 5)\n"
+    "  -m MIX         request weights, eg. get=4,cookie=2,post=2,upload=1\n"
+    "  -u BYTES       octet-stream upload size (default 4096)\n"
+    "  -t SECONDS     per-request timeout (default 5)\n"
+    "  -k             one connection per request (Connection: close)\n");
+  exit (1);
+  }  // end of usage
+
+// parse "get=4,post=1" into weights - unnamed types get weight 0
+static void parseMix (const char * text, Options & opt)
+  {
+  for (int i = 0; i < REQ_TYPE_COUNT; i++)
+    opt.weights [i] = 0;
+
+  std::string mix (text);
+  size_t start = 0;
+  while (start < mix.size ())
+    {
+    size_t end = mix.find (',', start);
+    if (end == std::string::npos)
+      end = mix.size ();
+    std::string item = mix.substr (start, end - start);
+    size_t eq = item.find ('=');
+    std::string name = item.substr (0, eq);
+    int weight = eq == std::string::npos ? 1 : atoi (item.c_str () + eq + 1);
+    int i;
+    for (i = 0; i < REQ_TYPE_COUNT; i++)
+      if (strcasecmp (name.c_str (), requestNames [i]) == 0)
+        break;
+    if (i == REQ_TYPE_COUNT || weight < 0)
+      {
+      fprintf (stderr, "loadgen: bad mix item '%s'\n", item.c_str ());
+      usage ();
+      }
+    opt.weights [i] = weight;
+    start = end + 1;
+    }
+  }  // end of parseMix
+
+static int connectLoopback (int port, double timeout)
+  {
+  int fd = socket (AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  int one = 1;
+  setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+  // a server which stops answering must not hang us (applies to connect too)
+  struct timeval tv;
+  tv.tv_sec = (time_t) timeout;
+  tv.tv_usec = (suseconds_t) ((timeout - tv.tv_sec) * 1e6);
+  setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+  setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+
+  struct sockaddr_in addr;
+  memset (&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons (port);
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (connect (fd, (struct sockaddr *) &addr, sizeof addr) < 0)
+    {
+    close (fd);
+    return -1;
+    }
+  return fd;
+  }  // end of connectLoopback
+
+static bool sendAll (int fd, const char * data, size_t length)
+  {
+  while (length > 0)
+    {
+    ssize_t n = send (fd, data, length, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    length -= n;
+    }
+  return true;
+  }  // end of sendAll
+
+// read one response: headers up to the blank line, then Content-Length bytes
+// (a timeout shows up as recv failing with EAGAIN, and counts as an error)
+static bool readResponse (int fd, std::string & pending, std::string & body)
+  {
+  char buf [4096];
+  size_t headerEnd;
+  while ((headerEnd = pending.find ("\r\n\r\n")) == std::string::npos)
+    {
+    ssize_t n = recv (fd, buf, sizeof buf, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    pending.append (buf, n);
+    }
+
+  if (pending.compare (0, 12, "HTTP/1.1 200") != 0 && pending.compare (0, 12, "HTTP/1.0 200") != 0)
+    return false;
+
+  unsigned long contentLength = 0;
+  for (size_t pos = pending.find ("\r\n"); pos < headerEnd; pos = pending.find ("\r\n", pos + 2))
+    if (strncasecmp (pending.c_str () + pos + 2, "Content-Length:", 15) == 0)
+      contentLength = strtoul (pending.c_str () + pos + 17, NULL, 10);
+
+  size_t total = headerEnd + 4 + contentLength;
+  while (pending.size () < total)
+    {
+    ssize_t n = recv (fd, buf, sizeof buf, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    pending.append (buf, n);
+    }
+  body.assign (pending, headerEnd + 4, contentLength);
+  pending.erase (0, total);
+  return true;
+  }  // end of readResponse
+
+// check benchserver's summary against what the request contained
+static bool checkResponse (const std::string & body, const Expected & expected)
+  {
+  unsigned long getArgs, headers, cookies, postArgs, bodyBytes;
+  if (sscanf (body.c_str (), "ok get=%lu headers=%lu cookies=%lu post=%lu body=%lu",
+              &getArgs, &headers, &cookies, &postArgs, &bodyBytes) != 5)
+    return false;
+  return getArgs   == expected.getArgs &&
+         cookies   == expected.cookies &&
+         postArgs  == expected.postArgs &&
+         bodyBytes == expected.bodyBytes;
+  }  // end of checkResponse
+
+static std::string buildRequest (RequestType type, const Options & opt, unsigned long seq)
+  {
+  char line [256];
+  std::string request;
+  std::string body;
+  const char * connection = opt.keepAlive ? "keep-alive" : "close";
+
+  switch (type)
+    {
+    case REQ_GET:
+      snprintf (line, sizeof line,
+                "GET /status?device=clock&mode=UTC&seq=%lu&name=Nick%%20Gammon HTTP/1.1\r\n", seq);
+      request = line;
+      break;
+
+    case REQ_COOKIE:
+      request = "GET /prefs HTTP/1.1\r\n";
+      snprintf (line, sizeof line, "Cookie: theme=light; session=%08lx; lang=en\r\n", seq);
+      request += line;
+      break;
+
+    case REQ_POST:
+      body = "action=add&name=Nick+Gammon&comment=Hello%2C+world%21&count=42";
+      request = "POST /form HTTP/1.1\r\n"
+                "Content-Type: application/x-www-form-urlencoded\r\n";
+      break;
+
+    case REQ_UPLOAD:
+      body.resize (opt.uploadSize);
+      for (size_t i = 0; i < body.size (); i++)
+        body [i] = (char) (i * 31 + seq);
+      request = "POST /upload HTTP/1.1\r\n"
+                "Content-Type: application/octet-stream\r\n";
+      break;
+
+    default:
+      break;
+    }  // end of switch
+
+  request += "Host: 127.0.0.1\r\n"
+             "User-Agent: HTTPserver-loadgen\r\n"
+             "Accept: */*\r\n";
+  snprintf (line, sizeof line, "Connection: %s\r\n", connection);
+  request += line;
+  if (type == REQ_POST || type == REQ_UPLOAD)
+    {
+    snprintf (line, sizeof line, "Content-Length: %lu\r\n", (unsigned long) body.size ());
+    request += line;
+    }
+  request += "\r\n";
+  request += body;
+  return request;
+  }  // end of buildRequest
+
+static void worker (int id, const Options & opt, Results & results)
+  {
+  int totalWeight = 0;
+  for (int i = 0; i < REQ_TYPE_COUNT; i++)
+    totalWeight += opt.weights [i];
+
+  // pre-build one request of each type so we measure the server, not us
+  std::vector<std::string> requests;
+  for (int i = 0; i < REQ_TYPE_COUNT; i++)
+    requests.push_back (buildRequest ((RequestType) i, opt, id));
+
+  // matches the arguments, cookies and bodies in buildRequest
+  const Expected expected [REQ_TYPE_COUNT] = {
+    { 4, 0, 0, 0 },                                 // get
+    { 0, 3, 0, 0 },                                 // cookie
+    { 0, 0, 4, 0 },                                 // post
+    { 0, 0, 0, (unsigned long) opt.uploadSize },    // upload
+  };
+
+  unsigned int seed = 12345 + id;
+  int fd = -1;
+  std::string pending;
+  std::string body;
+
+  while (!stopping)
+    {
+    int pick = rand_r (&seed) % totalWeight;
+    int type = 0;
+    while (pick >= opt.weights [type])
+      pick -= opt.weights [type++];
+
+    const std::string & request = requests [type];
+    Clock::time_point start = Clock::now ();
+
+    if (fd < 0)
+      {
+      fd = connectLoopback (opt.port, opt.timeout);
+      pending.clear ();
+      }
+    bool ok = fd >= 0 &&
+              sendAll (fd, request.data (), request.size ()) &&
+              readResponse (fd, pending, body) &&
+              checkResponse (body, expected [type]);
+
+    Clock::time_point finish = Clock::now ();
+
+    if (ok)
+      {
+      results.latencies.push_back (
+          std::chrono::duration_cast<std::chrono::microseconds> (finish - start).count ());
+      results.counts [type]++;
+      results.bytesSent += request.size ();
+      }
+    else
+      results.errors++;
+
+    if (!ok || !opt.keepAlive)
+      {
+      if (fd >= 0)
+        close (fd);
+      fd = -1;
+      }
+    }  // end of while
+
+  if (fd >= 0)
+    close (fd);
+  }  // end of worker
+
+static uint32_t percentile (const std::vector<uint32_t> & sorted, double p)
+  {
+  if (sorted.empty ())
+    return 0;
+  size_t index = (size_t) (p * (sorted.size () - 1) + 0.5);
+  return sorted [index];
+  }  // end of percentile
+
+int main (int argc, char * argv [])
+  {
+  Options opt;
+  int c;
+  while ((c = getopt (argc, argv, "p:c:d:m:u:t:kh")) != -1)
+    {
+    switch (c)
+      {
+      case 'p': opt.port = atoi (optarg); break;
+      case 'c': opt.connections = atoi (optarg); break;
+      case 'd': opt.duration = atof (optarg); break;
+      case 'm': parseMix (optarg, opt); break;
+      case 'u': opt.uploadSize = strtoul (optarg, NULL, 10); break;
+      case 't': opt.timeout = atof (optarg); break;
+      case 'k': opt.keepAlive = false; break;
+      default:  usage ();
+      }
+    }
+
+  int totalWeight = 0;
+  for (int i = 0; i < REQ_TYPE_COUNT; i++)
+    totalWeight += opt.weights [i];
+  if (opt.connections < 1 || opt.duration <= 0 || opt.timeout <= 0 || totalWeight <= 0 ||
+     (opt.weights [REQ_UPLOAD] > 0 && opt.uploadSize == 0))
+    usage ();
+
+  std::vector<Results> results (opt.connections);
+  std::vector<std::thread> threads;
+  Clock::time_point start = Clock::now ();
+  for (int i = 0; i < opt.connections; i++)
+    threads.push_back (std::thread (worker, i, std::cref (opt), std::ref (results [i])));
+
+  std::this_thread::sleep_for (std::chrono::duration<double> (opt.duration));
+  stopping = true;
+  for (size_t i = 0; i < threads.size (); i++)
+    threads [i].join ();
+  double elapsed = std::chrono::duration<double> (Clock::now () - start).count ();
+
+  // combine the per-thread results
+  Results total;
+  for (size_t i = 0; i < results.size (); i++)
+    {
+    total.latencies.insert (total.latencies.end (), results [i].latencies.begin (), results [i].latencies.end ());
+    for (int t = 0; t < REQ_TYPE_COUNT; t++)
+      total.counts [t] += results [i].counts [t];
+    total.errors += results [i].errors;
+    total.bytesSent += results [i].bytesSent;
+    }
+  std::sort (total.latencies.begin (), total.latencies.end ());
+  size_t completed = total.latencies.size ();
+
+  printf ("connections: %d  duration: %.2f s  %s\n",
+          opt.connections, elapsed, opt.keepAlive ? "keep-alive" : "connection per request");
+  printf ("requests:    %lu ok, %lu errors\n", (unsigned long) completed, total.errors);
+  for (int t = 0; t < REQ_TYPE_COUNT; t++)
+    if (opt.weights [t] > 0)
+      printf ("  %-8s   %lu\n", requestNames [t], total.counts [t]);
+  printf ("throughput:  %.1f requests/s, %.2f MB/s sent\n",
+          completed / elapsed, total.bytesSent / elapsed / 1e6);
+
+  if (completed > 0)
+    {
+    printf ("latency:     p50 %u us  p99 %u us  p999 %u us  max %u us\n",
+            percentile (total.latencies, 0.50),
+            percentile (total.latencies, 0.99),
+            percentile (total.latencies, 0.999),
+            total.latencies.back ());
+
+    // power-of-two buckets in microseconds
+    printf ("histogram:\n");
+    size_t pos = 0;
+    for (unsigned long long limit = 1; pos < completed; limit *= 2)
+      {
+      size_t count = 0;
+      while (pos < completed && total.latencies [pos] < limit)
+        {
+        count++;
+        pos++;
+        }
+      if (count > 0)
+        printf ("  < %8llu us  %8lu  %5.1f%%\n", limit, (unsigned long) count, 100.0 * count / completed);
+      }
+    }
+
+  // non-zero exit if anything went wrong, so this can gate a release
+  return total.errors > 0 || completed == 0 ? 2 : 0;
+  }  // end of main
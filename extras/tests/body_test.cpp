@@ -0,0 +1,94 @@
+// Host test for binary body handling: the application moving the body
+// itself (getBodyRemaining / bodyReceived) after some of it was fed a
+// byte at a time. Exits non-zero on failure.
+//
+// See README.md in this directory for how to build and run it.
+
+#include <Arduino.h>
+#include <HTTPserver.h>
+
+#include <string>
+
+unsigned long millis () { return 0; }
+
+static int failures = 0;
+
+#define CHECK(cond) \
+  do { if (!(cond)) { fprintf (stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+// stands in for a file: collects what is written to it
+class StringPrint : public Print
+  {
+  public:
+    std::string data;
+    size_t write (uint8_t c) { data += (char) c; return 1; }
+    using Print::write;
+  };  // end of StringPrint
+
+class testServer : public HTTPserver
+  {
+  public:
+    StringPrint * sink;
+  protected:
+    virtual void processPathname (const char * key, const byte flags) { setBodySink (sink); }
+  };  // end of testServer
+
+static const char HEADERS [] = "POST /upload HTTP/1.1\r\n"
+                               "Content-Type: application/octet-stream\r\n"
+                               "Content-Length: 6\r\n"
+                               "\r\n";
+
+// some body bytes fed one at a time, then the rest moved by the application
+static void testByteThenBodyReceived ()
+  {
+  StringPrint out, file;
+  testServer server;
+  server.sink = &file;
+  server.begin (&out);
+
+  for (const char * p = HEADERS; *p; p++)
+    server.processIncomingByte (*p);
+  for (const char * p = "abc"; *p; p++)
+    server.processIncomingByte (*p);
+  CHECK (!server.done);
+
+  // application takes over (eg. splice into the same file)
+  CHECK (server.getBodyRemaining () == 3);
+  file.print ("DEF");
+  server.bodyReceived (3);
+
+  CHECK (file.data == "abcDEF");
+  CHECK (server.done);
+  CHECK (server.getReceivedLength () == 6);
+  } // end of testByteThenBodyReceived
+
+// reporting more than was still to come is clamped
+static void testBodyReceivedClamped ()
+  {
+  StringPrint out, file;
+  testServer server;
+  server.sink = &file;
+  server.begin (&out);
+
+  server.processIncomingBytes ((const byte *) HEADERS, sizeof HEADERS - 1);
+  CHECK (server.getBodyRemaining () == 6);
+  server.bodyReceived (100);
+
+  CHECK (server.done);
+  CHECK (server.getReceivedLength () == 6);
+  CHECK (server.getBodyRemaining () == 0);
+  } // end of testBodyReceivedClamped
+
+int main ()
+  {
+  testByteThenBodyReceived ();
+  testBodyReceivedClamped ();
+
+  if (failures)
+    {
+    fprintf (stderr, "body_test: %d failure(s)\n", failures);
+    return 1;
+    }
+  printf ("body_test: all passed\n");
+  return 0;
+  } // end of main